@@ -0,0 +1,140 @@
+#include <time.h>
+#include "nf.h"
+
+// Compares the fixed-size kernels in NF_KERNEL_SHAPES against the generic ones.
+// Build it the way you build your models, e.g. gcc -O2 benchmark.c -o benchmark -lm
+
+double seconds_since(clock_t start) {
+    return (double)(clock() - start) / CLOCKS_PER_SEC;
+}
+
+void fill_random(float *values, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        values[i] = ((float)rand() / RAND_MAX) * 2 - 1;
+    }
+}
+
+// Feeding part of each output back into the input keeps the calls dependent,
+// so the compiler cannot hoist them out of the timing loop
+double time_forward(DenseKernel kernel, const float *w, const float *b, float *x, float *y, int iterations) {
+    clock_t start = clock();
+    for (int n = 0; n < iterations; n++) {
+        kernel.forward(w, b, x, y, kernel.input_size, kernel.output_size);
+        x[n % kernel.input_size] = y[n % kernel.output_size] * 1e-3f;
+    }
+    return seconds_since(start);
+}
+
+double time_backward(DenseKernel kernel, const float *w, const float *x, float *delta, float *dw, float *db, float *dx, int iterations) {
+    clock_t start = clock();
+    for (int n = 0; n < iterations; n++) {
+        kernel.backward(w, x, delta, dw, db, dx, kernel.input_size, kernel.output_size);
+        delta[n % kernel.output_size] = dx[n % kernel.input_size] * 1e-3f;
+    }
+    return seconds_since(start);
+}
+
+void benchmark_shape(DenseKernel fixed, int iterations) {
+    int in = fixed.input_size;
+    int out = fixed.output_size;
+    DenseKernel generic = generic_dense_kernel(in, out);
+
+    float *w = create_aligned_buffer((size_t)in * out);
+    float *dw = create_aligned_buffer((size_t)in * out);
+    float *b = create_aligned_buffer(out);
+    float *db = create_aligned_buffer(out);
+    float *y = create_aligned_buffer(out);
+    float *delta = create_aligned_buffer(out);
+    float *x = create_aligned_buffer(in);
+    float *dx = create_aligned_buffer(in);
+    if (!w || !dw || !b || !db || !y || !delta || !x || !dx) {
+        exit(1);
+    }
+    fill_random(w, (size_t)in * out);
+    fill_random(b, out);
+    fill_random(x, in);
+    fill_random(delta, out);
+
+    double generic_forward = time_forward(generic, w, b, x, y, iterations);
+    double fixed_forward = time_forward(fixed, w, b, x, y, iterations);
+    double generic_backward = time_backward(generic, w, x, delta, dw, db, dx, iterations);
+    double fixed_backward = time_backward(fixed, w, x, delta, dw, db, dx, iterations);
+
+    printf("%4dx%-4d forward  generic %.3fs  fixed %.3fs  (%.2fx)\n",
+        in, out, generic_forward, fixed_forward, generic_forward / fixed_forward);
+    printf("%4dx%-4d backward generic %.3fs  fixed %.3fs  (%.2fx)\n",
+        in, out, generic_backward, fixed_backward, generic_backward / fixed_backward);
+
+    free(w);
+    free(dw);
+    free(b);
+    free(db);
+    free(y);
+    free(delta);
+    free(x);
+    free(dx);
+}
+
+double time_train(NeuralNetwork *nn, const float *input, const float *target, int iterations) {
+    clock_t start = clock();
+    for (int n = 0; n < iterations; n++) {
+        train(nn, input, target);
+    }
+    return seconds_since(start);
+}
+
+// End to end on the sentiment network, with the same starting parameters for both runs
+void benchmark_train(int iterations) {
+    NeuralNetwork *nn = create_nn(HIDDEN_SIZE, HIDDEN_SIZE, 1, 1, LEARNING_RATE);
+    if (!nn) {
+        exit(1);
+    }
+    float *initial = create_aligned_buffer(nn->num_params);
+    float *input = create_aligned_buffer(nn->input_size);
+    if (!initial || !input) {
+        exit(1);
+    }
+    float target[1] = { 1.0f };
+    fill_random(input, nn->input_size);
+    memcpy(initial, nn->params, nn->num_params * sizeof(float));
+
+    double fixed = time_train(nn, input, target, iterations);
+
+    memcpy(nn->params, initial, nn->num_params * sizeof(float));
+    for (int l = 0; l < nn->num_layers; l++) {
+        nn->layers[l].kernel = generic_dense_kernel(nn->layers[l].input_size, nn->layers[l].output_size);
+    }
+    double generic = time_train(nn, input, target, iterations);
+
+    printf("train %d-%d-%d  generic %.3fs  fixed %.3fs  (%.2fx)\n",
+        nn->input_size, nn->hidden_size, nn->output_size, generic, fixed, generic / fixed);
+
+    free(initial);
+    free(input);
+    free(nn->params);
+    free(nn->workspace);
+    free(nn);
+}
+
+int main(int argc, char* argv[]) {
+    int iterations = 1000000;
+    if (argc > 1) {
+        iterations = atoi(argv[1]);
+        if (iterations < 1) {
+            printf("Invalid number of iterations\n");
+            return 1;
+        }
+    }
+
+#ifdef NF_VECTOR_KERNELS
+    printf("Vector kernels, %d floats wide\n", NF_VECTOR_WIDTH);
+#else
+    printf("Portable kernels\n");
+#endif
+    for (size_t i = 0; i < sizeof(dense_kernels) / sizeof(dense_kernels[0]); i++) {
+        benchmark_shape(dense_kernels[i], iterations);
+    }
+    benchmark_train(iterations / 4);
+
+    return 0;
+}
@@ -0,0 +1,256 @@
+#ifndef DENSE_KERNELS_H
+#define DENSE_KERNELS_H
+
+#include <stddef.h>
+#include "helpers.h"
+
+// y = W x + b for a row-major output_size x input_size matrix W
+typedef void (*DenseForwardKernel)(const float *NF_RESTRICT w, const float *NF_RESTRICT b,
+                                   const float *NF_RESTRICT x, float *NF_RESTRICT y,
+                                   int input_size, int output_size);
+
+// dW = delta x^T, db = delta and, when dx is not NULL, dx = W^T delta
+typedef void (*DenseBackwardKernel)(const float *NF_RESTRICT w, const float *NF_RESTRICT x,
+                                    const float *NF_RESTRICT delta, float *NF_RESTRICT dw,
+                                    float *NF_RESTRICT db, float *NF_RESTRICT dx,
+                                    int input_size, int output_size);
+
+typedef struct {
+    int input_size;
+    int output_size;
+    DenseForwardKernel forward;
+    DenseBackwardKernel backward;
+} DenseKernel;
+
+// Shapes (input, output) that get a fixed-size kernel: the HIDDEN_SIZE (64) layers
+// of the sentiment network with either a sigmoid head or a two-class softmax head.
+// sentiment_analysis.h refuses to build if HIDDEN_SIZE no longer matches.
+// Define NF_KERNEL_SHAPES before including nf.h to specialize for your own models.
+#ifndef NF_KERNEL_SHAPES
+#define NF_DEFAULT_KERNEL_SHAPES 1
+#define NF_KERNEL_SHAPES(X) \
+    X(64, 64)   \
+    X(64, 1)    \
+    X(64, 2)
+#endif
+
+// Loop bodies shared by the generic kernels and the portable fallback of the
+// fixed-size ones. The dot products accumulate into NF_ALIGN_FLOATS independent
+// lanes so the compiler can vectorize them without reassociating a single sum.
+#define DENSE_FORWARD_BODY(IN, OUT)                                   \
+    for (int i = 0; i < (OUT); i++) {                                 \
+        const float *row = w + (size_t)i * (IN);                      \
+        float lanes[NF_ALIGN_FLOATS] = {0};                           \
+        int j = 0;                                                    \
+        for (; j + NF_ALIGN_FLOATS <= (IN); j += NF_ALIGN_FLOATS) {   \
+            for (int k = 0; k < NF_ALIGN_FLOATS; k++) {               \
+                lanes[k] += row[j + k] * x[j + k];                    \
+            }                                                         \
+        }                                                             \
+        float sum = b[i];                                             \
+        for (; j < (IN); j++) {                                       \
+            sum += row[j] * x[j];                                     \
+        }                                                             \
+        for (int k = 0; k < NF_ALIGN_FLOATS; k++) {                   \
+            sum += lanes[k];                                          \
+        }                                                             \
+        y[i] = sum;                                                   \
+    }
+
+#define DENSE_BACKWARD_BODY(IN, OUT)                                  \
+    for (int i = 0; i < (OUT); i++) {                                 \
+        float *row = dw + (size_t)i * (IN);                           \
+        for (int j = 0; j < (IN); j++) {                              \
+            row[j] = delta[i] * x[j];                                 \
+        }                                                             \
+        db[i] = delta[i];                                             \
+    }                                                                 \
+    if (dx) {                                                         \
+        for (int j = 0; j < (IN); j++) {                              \
+            dx[j] = 0;                                                \
+        }                                                             \
+        for (int i = 0; i < (OUT); i++) {                             \
+            const float *row = w + (size_t)i * (IN);                  \
+            for (int j = 0; j < (IN); j++) {                          \
+                dx[j] += row[j] * delta[i];                           \
+            }                                                         \
+        }                                                             \
+    }
+
+// Runtime-sized fallback for shapes without a specialization
+void dense_forward_generic(const float *NF_RESTRICT w, const float *NF_RESTRICT b,
+                           const float *NF_RESTRICT x, float *NF_RESTRICT y,
+                           int input_size, int output_size) {
+    DENSE_FORWARD_BODY(input_size, output_size)
+}
+
+void dense_backward_generic(const float *NF_RESTRICT w, const float *NF_RESTRICT x,
+                            const float *NF_RESTRICT delta, float *NF_RESTRICT dw,
+                            float *NF_RESTRICT db, float *NF_RESTRICT dx,
+                            int input_size, int output_size) {
+    DENSE_BACKWARD_BODY(input_size, output_size)
+}
+
+// Fixed-size kernels. With GCC or Clang the shapes whose input width is a
+// multiple of NF_VECTOR_WIDTH run register-blocked code on vector extensions:
+// the forward pass computes four rows at a time so each load of x feeds four
+// independent accumulators, and the backward pass keeps a block of x and dx in
+// registers while it walks the rows once, writing dW and accumulating W^T delta
+// in the same pass. Other compilers and shapes use the loop bodies above with
+// literal bounds.
+#if defined(__GNUC__)
+#define NF_VECTOR_KERNELS 1
+#ifdef __AVX__
+#define NF_VECTOR_WIDTH 8
+#else
+#define NF_VECTOR_WIDTH 4
+#endif
+typedef float NFVector __attribute__((vector_size(NF_VECTOR_WIDTH * sizeof(float)), aligned(sizeof(float)), __may_alias__));
+#define NF_LOAD(p) (*(const NFVector *)(p))
+#define NF_STORE(p, v) (*(NFVector *)(p) = (v))
+
+NFVector nf_vector_splat(float value) {
+    NFVector v = {0};
+    return v + value;
+}
+
+float nf_vector_sum(NFVector v) {
+    float sum = 0;
+    for (int k = 0; k < NF_VECTOR_WIDTH; k++) {
+        sum += v[k];
+    }
+    return sum;
+}
+
+#define DENSE_FORWARD_FIXED(IN, OUT)                                              \
+    if ((IN) % NF_VECTOR_WIDTH != 0) {                                            \
+        DENSE_FORWARD_BODY(IN, OUT)                                               \
+        return;                                                                   \
+    }                                                                             \
+    int i = 0;                                                                    \
+    for (; i + 4 <= (OUT); i += 4) {                                              \
+        const float *r0 = w + (size_t)i * (IN);                                   \
+        const float *r1 = r0 + (IN);                                              \
+        const float *r2 = r1 + (IN);                                              \
+        const float *r3 = r2 + (IN);                                              \
+        NFVector a0 = {0}, a1 = {0}, a2 = {0}, a3 = {0};                          \
+        for (int j = 0; j < (IN); j += NF_VECTOR_WIDTH) {                         \
+            NFVector xv = NF_LOAD(x + j);                                         \
+            a0 += NF_LOAD(r0 + j) * xv;                                           \
+            a1 += NF_LOAD(r1 + j) * xv;                                           \
+            a2 += NF_LOAD(r2 + j) * xv;                                           \
+            a3 += NF_LOAD(r3 + j) * xv;                                           \
+        }                                                                         \
+        y[i] = b[i] + nf_vector_sum(a0);                                          \
+        y[i + 1] = b[i + 1] + nf_vector_sum(a1);                                  \
+        y[i + 2] = b[i + 2] + nf_vector_sum(a2);                                  \
+        y[i + 3] = b[i + 3] + nf_vector_sum(a3);                                  \
+    }                                                                             \
+    for (; i < (OUT); i++) {                                                      \
+        const float *row = w + (size_t)i * (IN);                                  \
+        NFVector a = {0};                                                         \
+        for (int j = 0; j < (IN); j += NF_VECTOR_WIDTH) {                         \
+            a += NF_LOAD(row + j) * NF_LOAD(x + j);                               \
+        }                                                                         \
+        y[i] = b[i] + nf_vector_sum(a);                                           \
+    }
+
+#define DENSE_BACKWARD_FIXED(IN, OUT)                                             \
+    if ((IN) % NF_VECTOR_WIDTH != 0) {                                            \
+        DENSE_BACKWARD_BODY(IN, OUT)                                              \
+        return;                                                                   \
+    }                                                                             \
+    for (int i = 0; i < (OUT); i++) {                                             \
+        db[i] = delta[i];                                                         \
+    }                                                                             \
+    int j = 0;                                                                    \
+    for (; j + 4 * NF_VECTOR_WIDTH <= (IN); j += 4 * NF_VECTOR_WIDTH) {           \
+        NFVector x0 = NF_LOAD(x + j);                                             \
+        NFVector x1 = NF_LOAD(x + j + NF_VECTOR_WIDTH);                           \
+        NFVector x2 = NF_LOAD(x + j + 2 * NF_VECTOR_WIDTH);                       \
+        NFVector x3 = NF_LOAD(x + j + 3 * NF_VECTOR_WIDTH);                       \
+        NFVector g0 = {0}, g1 = {0}, g2 = {0}, g3 = {0};                          \
+        for (int i = 0; i < (OUT); i++) {                                         \
+            const float *row = w + (size_t)i * (IN) + j;                          \
+            float *drow = dw + (size_t)i * (IN) + j;                              \
+            NFVector d = nf_vector_splat(delta[i]);                               \
+            NF_STORE(drow, d * x0);                                               \
+            NF_STORE(drow + NF_VECTOR_WIDTH, d * x1);                             \
+            NF_STORE(drow + 2 * NF_VECTOR_WIDTH, d * x2);                         \
+            NF_STORE(drow + 3 * NF_VECTOR_WIDTH, d * x3);                         \
+            if (dx) {                                                             \
+                g0 += NF_LOAD(row) * d;                                           \
+                g1 += NF_LOAD(row + NF_VECTOR_WIDTH) * d;                         \
+                g2 += NF_LOAD(row + 2 * NF_VECTOR_WIDTH) * d;                     \
+                g3 += NF_LOAD(row + 3 * NF_VECTOR_WIDTH) * d;                     \
+            }                                                                     \
+        }                                                                         \
+        if (dx) {                                                                 \
+            NF_STORE(dx + j, g0);                                                 \
+            NF_STORE(dx + j + NF_VECTOR_WIDTH, g1);                               \
+            NF_STORE(dx + j + 2 * NF_VECTOR_WIDTH, g2);                           \
+            NF_STORE(dx + j + 3 * NF_VECTOR_WIDTH, g3);                           \
+        }                                                                         \
+    }                                                                             \
+    for (; j < (IN); j += NF_VECTOR_WIDTH) {                                      \
+        NFVector xv = NF_LOAD(x + j);                                             \
+        NFVector g = {0};                                                         \
+        for (int i = 0; i < (OUT); i++) {                                         \
+            NFVector d = nf_vector_splat(delta[i]);                               \
+            NF_STORE(dw + (size_t)i * (IN) + j, d * xv);                          \
+            g += NF_LOAD(w + (size_t)i * (IN) + j) * d;                           \
+        }                                                                         \
+        if (dx) {                                                                 \
+            NF_STORE(dx + j, g);                                                  \
+        }                                                                         \
+    }
+#else
+#define DENSE_FORWARD_FIXED(IN, OUT) DENSE_FORWARD_BODY(IN, OUT)
+#define DENSE_BACKWARD_FIXED(IN, OUT) DENSE_BACKWARD_BODY(IN, OUT)
+#endif
+
+#define DEFINE_DENSE_KERNELS(IN, OUT)                                                        \
+    void dense_forward_##IN##x##OUT(const float *NF_RESTRICT w, const float *NF_RESTRICT b,  \
+                                    const float *NF_RESTRICT x, float *NF_RESTRICT y,        \
+                                    int input_size, int output_size) {                       \
+        (void)input_size;                                                                    \
+        (void)output_size;                                                                   \
+        DENSE_FORWARD_FIXED(IN, OUT)                                                         \
+    }                                                                                        \
+    void dense_backward_##IN##x##OUT(const float *NF_RESTRICT w, const float *NF_RESTRICT x, \
+                                     const float *NF_RESTRICT delta, float *NF_RESTRICT dw,  \
+                                     float *NF_RESTRICT db, float *NF_RESTRICT dx,           \
+                                     int input_size, int output_size) {                      \
+        (void)input_size;                                                                    \
+        (void)output_size;                                                                   \
+        DENSE_BACKWARD_FIXED(IN, OUT)                                                        \
+    }
+
+#define DENSE_KERNEL_ENTRY(IN, OUT) \
+    { IN, OUT, dense_forward_##IN##x##OUT, dense_backward_##IN##x##OUT },
+
+NF_KERNEL_SHAPES(DEFINE_DENSE_KERNELS)
+
+DenseKernel generic_dense_kernel(int input_size, int output_size) {
+    DenseKernel kernel = { input_size, output_size, dense_forward_generic, dense_backward_generic };
+    return kernel;
+}
+
+const DenseKernel dense_kernels[] = {
+    NF_KERNEL_SHAPES(DENSE_KERNEL_ENTRY)
+};
+
+// Pick the fixed-size kernel for a layer shape, or the generic one.
+// Build with NF_GENERIC_KERNELS to always use the generic path.
+DenseKernel select_dense_kernel(int input_size, int output_size) {
+#ifndef NF_GENERIC_KERNELS
+    for (size_t i = 0; i < sizeof(dense_kernels) / sizeof(dense_kernels[0]); i++) {
+        if (dense_kernels[i].input_size == input_size && dense_kernels[i].output_size == output_size) {
+            return dense_kernels[i];
+        }
+    }
+#endif
+    return generic_dense_kernel(input_size, output_size);
+}
+
+#endif
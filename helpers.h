@@ -4,6 +4,16 @@
 #include <math.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+#define NF_ALIGNMENT 64
+#define NF_ALIGN_FLOATS (NF_ALIGNMENT / (int)sizeof(float))
+
+#ifdef __cplusplus
+#define NF_RESTRICT __restrict
+#else
+#define NF_RESTRICT restrict
+#endif
 
 float sigmoid(float x) {
     return 1.0 / (1.0 + exp(-x));
@@ -18,4 +28,21 @@ float* create_embedding_chatbot(int size) {
     return embedding;
 }
 
+// Round a float count up so the next buffer starts on an NF_ALIGNMENT boundary
+size_t align_floats(size_t count) {
+    return (count + NF_ALIGN_FLOATS - 1) / NF_ALIGN_FLOATS * NF_ALIGN_FLOATS;
+}
+
+// Zeroed, NF_ALIGNMENT-aligned float buffer. Returns NULL if allocation fails.
+float* create_aligned_buffer(size_t count) {
+    size_t size = align_floats(count > 0 ? count : 1) * sizeof(float);
+    float *buffer = (float *)aligned_alloc(NF_ALIGNMENT, size);
+    if (!buffer) {
+        fprintf(stderr, "Memory allocation failed\n");
+        return NULL;
+    }
+    memset(buffer, 0, size);
+    return buffer;
+}
+
 #endif
\ No newline at end of file
@@ -2,6 +2,9 @@
 
 int main() {
     NeuralNetwork *nn = load_nn("nn.bin");
+    if (!nn) {
+        return 1;
+    }
     
     // Example predictions
     const char *test_samples[] = {
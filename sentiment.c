@@ -27,6 +27,9 @@ int main(int argc, char* argv[]) {
     add_words(words, sizeof(words) / sizeof(words[0]));
 
     NeuralNetwork *nn = create_nn(HIDDEN_SIZE, HIDDEN_SIZE, 1, epochs, learning_rate);
+    if (!nn) {
+        return 1;
+    }
     
     const char *positive_samples[] = {
         "good movie", "excellent performance", "amazing experience",
@@ -6,10 +6,14 @@
 #include <string.h>
 #include <math.h>
 #include "helpers.h"
+#include "dense_kernels.h"
 
 #define MAX_WORDS 1000
 #define MAX_WORD_LENGTH 50
 #define HIDDEN_SIZE 64
+#if defined(NF_DEFAULT_KERNEL_SHAPES) && HIDDEN_SIZE != 64
+#error "The default NF_KERNEL_SHAPES in dense_kernels.h assume HIDDEN_SIZE 64"
+#endif
 #define EPOCHS 3000
 #define LEARNING_RATE 0.01
 #define PRINT_INTERVAL 500
@@ -19,11 +23,37 @@ typedef struct {
     float *embedding;
 } Word;
 
+#define MAX_LAYERS 8
+#define MAX_LAYER_SIZE 65536
+#define NN_MAGIC 0x4E4E464E  // "NFNN"
+#define NN_VERSION 2
+
+typedef enum {
+    ACTIVATION_SIGMOID,
+    ACTIVATION_SOFTMAX
+} Activation;
+
+typedef struct {
+    int input_size;
+    int output_size;
+    Activation activation;
+    size_t weights;  // Offset of the output_size x input_size weight matrix in the slab
+    size_t biases;   // Offset of the bias vector in the slab
+    size_t outputs;  // Offset of this layer's activations in the workspace
+    DenseKernel kernel;  // Fixed-size kernel for this shape, or the generic one
+} Layer;
+
 typedef struct {
     int input_size;
-    int hidden_size;
+    int hidden_size;  // Width of the first hidden layer (0 if there is none)
     int output_size;
-    float *w1, *w2, *b1, *b2;
+    int num_layers;
+    Layer layers[MAX_LAYERS];
+    float *params;       // One 64-byte-aligned slab holding all parameters, then all gradients
+    float *grads;        // Points into the slab; same layout as params
+    size_t num_params;   // Padded parameter count (gradients follow at this offset)
+    float *workspace;    // Layer activations followed by two delta buffers
+    float *deltas[2];
     int epochs;
     float learning_rate;
 } NeuralNetwork;
@@ -52,67 +82,203 @@ void add_word(const char *word) {
     }
 }
 
-NeuralNetwork* create_nn(int input_size, int hidden_size, int output_size, int epochs, float learning_rate) {
-    NeuralNetwork *nn = (NeuralNetwork *)malloc(sizeof(NeuralNetwork));
+// Check a layer description: num_layers + 1 widths, input first
+int validate_layers(const int *layer_sizes, int num_layers, Activation output_activation) {
+    if (num_layers < 1 || num_layers > MAX_LAYERS) {
+        fprintf(stderr, "Invalid number of layers: %d\n", num_layers);
+        return -1;
+    }
+    for (int l = 0; l <= num_layers; l++) {
+        if (layer_sizes[l] <= 0 || layer_sizes[l] > MAX_LAYER_SIZE) {
+            fprintf(stderr, "Invalid layer size: %d\n", layer_sizes[l]);
+            return -1;
+        }
+    }
+    if (output_activation != ACTIVATION_SIGMOID && output_activation != ACTIVATION_SOFTMAX) {
+        fprintf(stderr, "Invalid output activation: %d\n", output_activation);
+        return -1;
+    }
+    if (output_activation == ACTIVATION_SOFTMAX && layer_sizes[num_layers] < 2) {
+        fprintf(stderr, "Softmax output needs at least 2 classes\n");
+        return -1;
+    }
+    return 0;
+}
+
+// Lay out the dense layers described by layer_sizes (num_layers + 1 widths, input first)
+// and allocate the parameter slab and workspace. Hidden layers use sigmoid.
+// Returns -1 without allocating anything on invalid sizes or allocation failure.
+int init_layers(NeuralNetwork *nn, const int *layer_sizes, int num_layers, Activation output_activation) {
+    if (validate_layers(layer_sizes, num_layers, output_activation) != 0) {
+        return -1;
+    }
+
+    size_t num_params = 0;
+    size_t num_outputs = 0;
+    int max_width = 0;
+    for (int l = 0; l < num_layers; l++) {
+        Layer *layer = &nn->layers[l];
+        layer->input_size = layer_sizes[l];
+        layer->output_size = layer_sizes[l + 1];
+        layer->activation = (l == num_layers - 1) ? output_activation : ACTIVATION_SIGMOID;
+        layer->kernel = select_dense_kernel(layer->input_size, layer->output_size);
+        layer->weights = num_params;
+        num_params += align_floats((size_t)layer->input_size * layer->output_size);
+        layer->biases = num_params;
+        num_params += align_floats(layer->output_size);
+        layer->outputs = num_outputs;
+        num_outputs += align_floats(layer->output_size);
+        if (layer->output_size > max_width) {
+            max_width = layer->output_size;
+        }
+    }
+
+    size_t delta_size = align_floats(max_width);
+    float *params = create_aligned_buffer(2 * num_params);
+    float *workspace = create_aligned_buffer(num_outputs + 2 * delta_size);
+    if (!params || !workspace) {
+        free(params);
+        free(workspace);
+        return -1;
+    }
+
+    nn->num_layers = num_layers;
+    nn->input_size = layer_sizes[0];
+    nn->hidden_size = (num_layers > 1) ? layer_sizes[1] : 0;
+    nn->output_size = layer_sizes[num_layers];
+
+    nn->num_params = num_params;
+    nn->params = params;
+    nn->grads = nn->params + num_params;
+    nn->workspace = workspace;
+    nn->deltas[0] = nn->workspace + num_outputs;
+    nn->deltas[1] = nn->deltas[0] + delta_size;
+    return 0;
+}
+
+void randomize_params(NeuralNetwork *nn) {
+    for (int l = 0; l < nn->num_layers; l++) {
+        Layer *layer = &nn->layers[l];
+        float *w = nn->params + layer->weights;
+        float *b = nn->params + layer->biases;
+        size_t num_weights = (size_t)layer->input_size * layer->output_size;
+        for (size_t i = 0; i < num_weights; i++) {
+            w[i] = ((float)rand() / RAND_MAX) * 2 - 1;
+        }
+        for (int i = 0; i < layer->output_size; i++) {
+            b[i] = ((float)rand() / RAND_MAX) * 2 - 1;
+        }
+    }
+}
+
+// Returns NULL if the layer description is invalid or the network cannot be allocated
+NeuralNetwork* create_nn_layers(const int *layer_sizes, int num_layers, Activation output_activation, int epochs, float learning_rate) {
+    NeuralNetwork *nn = (NeuralNetwork *)calloc(1, sizeof(NeuralNetwork));
     if (!nn) {
         fprintf(stderr, "Memory allocation failed\n");
-        exit(1);
+        return NULL;
+    }
+    if (init_layers(nn, layer_sizes, num_layers, output_activation) != 0) {
+        free(nn);
+        return NULL;
     }
-    nn->input_size = input_size;
-    nn->hidden_size = hidden_size;
-    nn->output_size = output_size;
     nn->epochs = (epochs > 0) ? epochs : EPOCHS;  // Use default if not provided
     nn->learning_rate = (learning_rate > 0) ? learning_rate : LEARNING_RATE;  // Use default if not provided
-    
-    nn->w1 = create_embedding(input_size * hidden_size);
-    nn->w2 = create_embedding(hidden_size * output_size);
-    nn->b1 = create_embedding(hidden_size);
-    nn->b2 = create_embedding(output_size);
-    
+
+    randomize_params(nn);
     return nn;
 }
 
-void forward(NeuralNetwork *nn, float *input, float *hidden, float *output) {
-    for (int i = 0; i < nn->hidden_size; i++) {
-        hidden[i] = 0;
-        for (int j = 0; j < nn->input_size; j++) {
-            hidden[i] += input[j] * nn->w1[i * nn->input_size + j];
+NeuralNetwork* create_nn(int input_size, int hidden_size, int output_size, int epochs, float learning_rate) {
+    int layer_sizes[] = { input_size, hidden_size, output_size };
+    return create_nn_layers(layer_sizes, 2, ACTIVATION_SIGMOID, epochs, learning_rate);
+}
+
+void activate(const Layer *layer, float *output) {
+    if (layer->activation == ACTIVATION_SOFTMAX) {
+        float max = output[0];
+        for (int i = 1; i < layer->output_size; i++) {
+            if (output[i] > max) {
+                max = output[i];
+            }
         }
-        hidden[i] = sigmoid(hidden[i] + nn->b1[i]);
-    }
-    
-    for (int i = 0; i < nn->output_size; i++) {
-        output[i] = 0;
-        for (int j = 0; j < nn->hidden_size; j++) {
-            output[i] += hidden[j] * nn->w2[i * nn->hidden_size + j];
+        float sum = 0;
+        for (int i = 0; i < layer->output_size; i++) {
+            output[i] = expf(output[i] - max);
+            sum += output[i];
+        }
+        for (int i = 0; i < layer->output_size; i++) {
+            output[i] /= sum;
+        }
+    } else {
+        for (int i = 0; i < layer->output_size; i++) {
+            output[i] = sigmoid(output[i]);
         }
-        output[i] = sigmoid(output[i] + nn->b2[i]);
     }
 }
 
-void train(NeuralNetwork *nn, float *input, float target) {
-    float hidden[HIDDEN_SIZE];
-    float output[1];
-    float d_hidden[HIDDEN_SIZE];
-    
-    forward(nn, input, hidden, output);
-    
-    float error = target - output[0];
-    float d_output = error * output[0] * (1 - output[0]);
-    
-    for (int j = 0; j < nn->hidden_size; j++) {
-        nn->w2[j] += nn->learning_rate * d_output * hidden[j];
-        d_hidden[j] = nn->w2[j] * d_output;
+// Run the network and return its output, which lives in nn->workspace until the next call
+const float* forward(NeuralNetwork *nn, const float *input) {
+    const float *x = input;
+    for (int l = 0; l < nn->num_layers; l++) {
+        const Layer *layer = &nn->layers[l];
+        const float *w = nn->params + layer->weights;
+        const float *b = nn->params + layer->biases;
+        float *y = nn->workspace + layer->outputs;
+        layer->kernel.forward(w, b, x, y, layer->input_size, layer->output_size);
+        activate(layer, y);
+        x = y;
     }
-    nn->b2[0] += nn->learning_rate * d_output;
-    
-    for (int i = 0; i < nn->hidden_size; i++) {
-        float d_h = d_hidden[i] * hidden[i] * (1 - hidden[i]);
-        for (int j = 0; j < nn->input_size; j++) {
-            nn->w1[i * nn->input_size + j] += nn->learning_rate * d_h * input[j];
+    return x;
+}
+
+// Fused SGD step over the whole slab; padding is zero in both halves so it stays zero
+void apply_gradients(NeuralNetwork *nn) {
+    float *params = nn->params;
+    const float *grads = nn->grads;
+    for (size_t i = 0; i < nn->num_params; i++) {
+        params[i] -= nn->learning_rate * grads[i];
+    }
+}
+
+// One SGD step on a single sample. Sigmoid outputs use squared error, softmax
+// outputs use cross-entropy. Returns the mean absolute error before the update.
+float train(NeuralNetwork *nn, const float *input, const float *target) {
+    const float *output = forward(nn, input);
+    const Layer *last = &nn->layers[nn->num_layers - 1];
+    float *delta = nn->deltas[0];
+    float *prev_delta = nn->deltas[1];
+    float error = 0;
+
+    for (int i = 0; i < nn->output_size; i++) {
+        float diff = output[i] - target[i];
+        error += fabsf(diff);
+        delta[i] = (last->activation == ACTIVATION_SOFTMAX) ? diff : diff * output[i] * (1 - output[i]);
+    }
+
+    for (int l = nn->num_layers - 1; l >= 0; l--) {
+        const Layer *layer = &nn->layers[l];
+        const float *x = (l > 0) ? nn->workspace + nn->layers[l - 1].outputs : input;
+        const float *w = nn->params + layer->weights;
+        float *dw = nn->grads + layer->weights;
+        float *db = nn->grads + layer->biases;
+
+        layer->kernel.backward(w, x, delta, dw, db, (l > 0) ? prev_delta : NULL,
+                               layer->input_size, layer->output_size);
+
+        if (l > 0) {
+            // Hidden layers are sigmoid, so x is the previous layer's activation
+            for (int j = 0; j < layer->input_size; j++) {
+                prev_delta[j] *= x[j] * (1 - x[j]);
+            }
+            float *tmp = delta;
+            delta = prev_delta;
+            prev_delta = tmp;
         }
-        nn->b1[i] += nn->learning_rate * d_h;
     }
+
+    apply_gradients(nn);
+    return error / nn->output_size;
 }
 
 float* text_to_input(const char *text) {
@@ -152,23 +318,48 @@ float* text_to_input(const char *text) {
     return input;
 }
 
+// Text is fed in as averaged HIDDEN_SIZE-wide word embeddings, so only networks
+// with that input width can be trained on or predict from text
+int check_text_input(NeuralNetwork *nn) {
+    if (nn->input_size != HIDDEN_SIZE) {
+        fprintf(stderr, "Text input needs input size %d, network has %d\n", HIDDEN_SIZE, nn->input_size);
+        return -1;
+    }
+    return 0;
+}
+
+// Binary targets: a single sigmoid output learns 1/0, wider heads learn class 1/class 0
+void set_sentiment_target(NeuralNetwork *nn, float *target, int positive) {
+    memset(target, 0, nn->output_size * sizeof(float));
+    if (nn->output_size == 1) {
+        target[0] = positive ? 1.0f : 0.0f;
+    } else {
+        target[positive ? 1 : 0] = 1.0f;
+    }
+}
+
 void train_nn(NeuralNetwork *nn, const char *positive_samples[], const char *negative_samples[], int num_samples) {
+    if (check_text_input(nn) != 0) {
+        return;
+    }
+
+    float *pos_target = (float *)malloc(nn->output_size * sizeof(float));
+    float *neg_target = (float *)malloc(nn->output_size * sizeof(float));
+    if (!pos_target || !neg_target) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    set_sentiment_target(nn, pos_target, 1);
+    set_sentiment_target(nn, neg_target, 0);
+
     for (int epoch = 0; epoch < nn->epochs; epoch++) {
         float total_error = 0;
         for (int i = 0; i < num_samples; i++) {
             float *pos_input = text_to_input(positive_samples[i]);
             float *neg_input = text_to_input(negative_samples[i]);
             
-            float pos_output[1], neg_output[1];
-            float hidden[HIDDEN_SIZE];
-            
-            forward(nn, pos_input, hidden, pos_output);
-            total_error += fabs(1 - pos_output[0]);
-            train(nn, pos_input, 1.0);
-            
-            forward(nn, neg_input, hidden, neg_output);
-            total_error += fabs(0 - neg_output[0]);
-            train(nn, neg_input, 0.0);
+            total_error += train(nn, pos_input, pos_target);
+            total_error += train(nn, neg_input, neg_target);
             
             free(pos_input);
             free(neg_input);
@@ -178,27 +369,55 @@ void train_nn(NeuralNetwork *nn, const char *positive_samples[], const char *neg
             printf("\033[1;37mEpoch %d, Average Error: %f\033[0m\n", epoch, total_error / (2 * num_samples));
         }
     }
+
+    free(pos_target);
+    free(neg_target);
 }
 
 void free_nn(NeuralNetwork *nn) {
     for (int i = 0; i < vocab_size; i++) {
         free(vocabulary[i].embedding);
     }
-    free(nn->w1);
-    free(nn->w2);
-    free(nn->b1);
-    free(nn->b2);
+    free(nn->params);
+    free(nn->workspace);
     free(nn);
 }
 
+// Probability that text is positive (class 1 for multi-class heads), or -1 if the
+// network cannot take text input
 float predict(NeuralNetwork *nn, const char *text) {
+    if (check_text_input(nn) != 0) {
+        return -1.0f;
+    }
     float *input = text_to_input(text);
-    float hidden[HIDDEN_SIZE];
-    float output[1];
+    const float *output = forward(nn, input);
+    float prediction = (nn->output_size == 1) ? output[0] : output[1];
     
-    forward(nn, input, hidden, output);
+    free(input);
+    return prediction;
+}
+
+// Index of the most likely output class (1 = positive for a single sigmoid output),
+// or -1 if the network cannot take text input
+int predict_class(NeuralNetwork *nn, const char *text) {
+    if (check_text_input(nn) != 0) {
+        return -1;
+    }
+    float *input = text_to_input(text);
+    const float *output = forward(nn, input);
+    int best = 0;
+    if (nn->output_size == 1) {
+        best = output[0] > 0.5f;
+    } else {
+        for (int i = 1; i < nn->output_size; i++) {
+            if (output[i] > output[best]) {
+                best = i;
+            }
+        }
+    }
     
-    return output[0];
+    free(input);
+    return best;
 }
 
 void add_words(const char *words[], int count) {
@@ -207,6 +426,28 @@ void add_words(const char *words[], int count) {
     }
 }
 
+// Parameters are stored layer by layer, weights then biases, without the slab's
+// alignment padding, so saved models do not depend on NF_ALIGNMENT
+void write_params(NeuralNetwork *nn, FILE *file) {
+    for (int l = 0; l < nn->num_layers; l++) {
+        const Layer *layer = &nn->layers[l];
+        fwrite(nn->params + layer->weights, sizeof(float), (size_t)layer->input_size * layer->output_size, file);
+        fwrite(nn->params + layer->biases, sizeof(float), layer->output_size, file);
+    }
+}
+
+int read_params(NeuralNetwork *nn, FILE *file) {
+    for (int l = 0; l < nn->num_layers; l++) {
+        const Layer *layer = &nn->layers[l];
+        size_t num_weights = (size_t)layer->input_size * layer->output_size;
+        if (fread(nn->params + layer->weights, sizeof(float), num_weights, file) != num_weights ||
+            fread(nn->params + layer->biases, sizeof(float), layer->output_size, file) != (size_t)layer->output_size) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
 void save_nn(NeuralNetwork *nn, const char *filename) {
     FILE *file = fopen(filename, "wb");
     if (!file) {
@@ -214,6 +455,11 @@ void save_nn(NeuralNetwork *nn, const char *filename) {
         return;
     }
 
+    int magic = NN_MAGIC;
+    int version = NN_VERSION;
+    fwrite(&magic, sizeof(int), 1, file);
+    fwrite(&version, sizeof(int), 1, file);
+
     // Write vocabulary size and words
     fwrite(&vocab_size, sizeof(int), 1, file);
     for (int i = 0; i < vocab_size; i++) {
@@ -221,22 +467,150 @@ void save_nn(NeuralNetwork *nn, const char *filename) {
         fwrite(vocabulary[i].embedding, sizeof(float), HIDDEN_SIZE, file);
     }
 
-    // Write network structure and hyperparameters
+    // Write layer descriptors and hyperparameters
+    int output_activation = nn->layers[nn->num_layers - 1].activation;
+    fwrite(&nn->num_layers, sizeof(int), 1, file);
     fwrite(&nn->input_size, sizeof(int), 1, file);
-    fwrite(&nn->hidden_size, sizeof(int), 1, file);
-    fwrite(&nn->output_size, sizeof(int), 1, file);
+    for (int l = 0; l < nn->num_layers; l++) {
+        fwrite(&nn->layers[l].output_size, sizeof(int), 1, file);
+    }
+    fwrite(&output_activation, sizeof(int), 1, file);
     fwrite(&nn->epochs, sizeof(int), 1, file);
     fwrite(&nn->learning_rate, sizeof(float), 1, file);
 
-    // Write weights and biases
-    fwrite(nn->w1, sizeof(float), nn->input_size * nn->hidden_size, file);
-    fwrite(nn->w2, sizeof(float), nn->hidden_size * nn->output_size, file);
-    fwrite(nn->b1, sizeof(float), nn->hidden_size, file);
-    fwrite(nn->b2, sizeof(float), nn->output_size, file);
+    write_params(nn, file);
 
     fclose(file);
 }
 
+// Bytes between the current position and the end of the file
+long remaining_bytes(FILE *file) {
+    long position = ftell(file);
+    if (position < 0 || fseek(file, 0, SEEK_END) != 0) {
+        return -1;
+    }
+    long end = ftell(file);
+    fseek(file, position, SEEK_SET);
+    return end - position;
+}
+
+// Fail before allocating if the file cannot hold the parameters the header promises
+int check_params_fit(const int *layer_sizes, int num_layers, FILE *file) {
+    size_t num_params = 0;
+    for (int l = 0; l < num_layers; l++) {
+        num_params += ((size_t)layer_sizes[l] + 1) * layer_sizes[l + 1];
+    }
+    long remaining = remaining_bytes(file);
+    if (remaining < 0 || num_params * sizeof(float) > (size_t)remaining) {
+        fprintf(stderr, "Truncated model file\n");
+        return -1;
+    }
+    return 0;
+}
+
+void free_vocabulary(void) {
+    for (int i = 0; i < vocab_size; i++) {
+        free(vocabulary[i].embedding);
+        vocabulary[i].embedding = NULL;
+    }
+    vocab_size = 0;
+}
+
+int read_vocabulary(FILE *file, int count) {
+    if (count < 0 || count > MAX_WORDS) {
+        fprintf(stderr, "Invalid vocabulary size: %d\n", count);
+        return -1;
+    }
+    vocab_size = 0;
+    for (int i = 0; i < count; i++) {
+        float *embedding = (float *)malloc(HIDDEN_SIZE * sizeof(float));
+        if (!embedding) {
+            fprintf(stderr, "Memory allocation failed\n");
+            free_vocabulary();
+            return -1;
+        }
+        if (fread(vocabulary[i].word, sizeof(char), MAX_WORD_LENGTH, file) != MAX_WORD_LENGTH ||
+            fread(embedding, sizeof(float), HIDDEN_SIZE, file) != HIDDEN_SIZE) {
+            fprintf(stderr, "Truncated model file\n");
+            free(embedding);
+            free_vocabulary();
+            return -1;
+        }
+        vocabulary[i].word[MAX_WORD_LENGTH - 1] = '\0';
+        vocabulary[i].embedding = embedding;
+        vocab_size++;
+    }
+    return 0;
+}
+
+// Reads the pre-slab format: in/hidden/out sizes followed by w1, w2, b1, b2
+int load_legacy_nn(NeuralNetwork *nn, FILE *file) {
+    int layer_sizes[3];
+    if (fread(layer_sizes, sizeof(int), 3, file) != 3 ||
+        fread(&nn->epochs, sizeof(int), 1, file) != 1 ||
+        fread(&nn->learning_rate, sizeof(float), 1, file) != 1) {
+        fprintf(stderr, "Truncated model file\n");
+        return -1;
+    }
+
+    if (validate_layers(layer_sizes, 2, ACTIVATION_SIGMOID) != 0 ||
+        check_params_fit(layer_sizes, 2, file) != 0 ||
+        init_layers(nn, layer_sizes, 2, ACTIVATION_SIGMOID) != 0) {
+        return -1;
+    }
+
+    Layer *hidden = &nn->layers[0];
+    Layer *output = &nn->layers[1];
+    size_t hidden_weights = (size_t)hidden->input_size * hidden->output_size;
+    size_t output_weights = (size_t)output->input_size * output->output_size;
+    if (fread(nn->params + hidden->weights, sizeof(float), hidden_weights, file) != hidden_weights ||
+        fread(nn->params + output->weights, sizeof(float), output_weights, file) != output_weights ||
+        fread(nn->params + hidden->biases, sizeof(float), hidden->output_size, file) != (size_t)hidden->output_size ||
+        fread(nn->params + output->biases, sizeof(float), output->output_size, file) != (size_t)output->output_size) {
+        fprintf(stderr, "Truncated model file\n");
+        free(nn->params);
+        free(nn->workspace);
+        return -1;
+    }
+    return 0;
+}
+
+int load_layered_nn(NeuralNetwork *nn, FILE *file) {
+    int num_layers = 0;
+    if (fread(&num_layers, sizeof(int), 1, file) != 1) {
+        fprintf(stderr, "Truncated model file\n");
+        return -1;
+    }
+    if (num_layers < 1 || num_layers > MAX_LAYERS) {
+        fprintf(stderr, "Invalid number of layers: %d\n", num_layers);
+        return -1;
+    }
+
+    int layer_sizes[MAX_LAYERS + 1];
+    int output_activation = ACTIVATION_SIGMOID;
+    if (fread(layer_sizes, sizeof(int), num_layers + 1, file) != (size_t)num_layers + 1 ||
+        fread(&output_activation, sizeof(int), 1, file) != 1 ||
+        fread(&nn->epochs, sizeof(int), 1, file) != 1 ||
+        fread(&nn->learning_rate, sizeof(float), 1, file) != 1) {
+        fprintf(stderr, "Truncated model file\n");
+        return -1;
+    }
+
+    if (validate_layers(layer_sizes, num_layers, (Activation)output_activation) != 0 ||
+        check_params_fit(layer_sizes, num_layers, file) != 0 ||
+        init_layers(nn, layer_sizes, num_layers, (Activation)output_activation) != 0) {
+        return -1;
+    }
+
+    if (read_params(nn, file) != 0) {
+        fprintf(stderr, "Truncated model file\n");
+        free(nn->params);
+        free(nn->workspace);
+        return -1;
+    }
+    return 0;
+}
+
 NeuralNetwork* load_nn(const char *filename) {
     FILE *file = fopen(filename, "rb");
     if (!file) {
@@ -244,52 +618,50 @@ NeuralNetwork* load_nn(const char *filename) {
         return NULL;
     }
 
-    // Read vocabulary size and words
-    fread(&vocab_size, sizeof(int), 1, file);
-    for (int i = 0; i < vocab_size; i++) {
-        fread(vocabulary[i].word, sizeof(char), MAX_WORD_LENGTH, file);
-        vocabulary[i].embedding = (float *)malloc(HIDDEN_SIZE * sizeof(float));
-        fread(vocabulary[i].embedding, sizeof(float), HIDDEN_SIZE, file);
+    // Files written before the layer format start directly with the vocabulary size
+    int header = 0;
+    int version = 0;
+    if (fread(&header, sizeof(int), 1, file) != 1) {
+        fprintf(stderr, "Truncated model file\n");
+        fclose(file);
+        return NULL;
+    }
+    int legacy = (header != NN_MAGIC);
+    if (!legacy) {
+        if (fread(&version, sizeof(int), 1, file) != 1 ||
+            fread(&header, sizeof(int), 1, file) != 1) {
+            fprintf(stderr, "Truncated model file\n");
+            fclose(file);
+            return NULL;
+        }
+        if (version != NN_VERSION) {
+            fprintf(stderr, "Unsupported model version: %d\n", version);
+            fclose(file);
+            return NULL;
+        }
     }
 
-    NeuralNetwork *nn = (NeuralNetwork *)malloc(sizeof(NeuralNetwork));
-    if (!nn) {
-        fprintf(stderr, "Memory allocation failed\n");
+    // Read vocabulary size and words
+    if (read_vocabulary(file, header) != 0) {
         fclose(file);
         return NULL;
     }
 
-    // Read network structure and hyperparameters
-    fread(&nn->input_size, sizeof(int), 1, file);
-    fread(&nn->hidden_size, sizeof(int), 1, file);
-    fread(&nn->output_size, sizeof(int), 1, file);
-    fread(&nn->epochs, sizeof(int), 1, file);
-    fread(&nn->learning_rate, sizeof(float), 1, file);
-
-    // Allocate memory for weights and biases
-    nn->w1 = (float *)malloc(nn->input_size * nn->hidden_size * sizeof(float));
-    nn->w2 = (float *)malloc(nn->hidden_size * nn->output_size * sizeof(float));
-    nn->b1 = (float *)malloc(nn->hidden_size * sizeof(float));
-    nn->b2 = (float *)malloc(nn->output_size * sizeof(float));
-
-    if (!nn->w1 || !nn->w2 || !nn->b1 || !nn->b2) {
+    NeuralNetwork *nn = (NeuralNetwork *)calloc(1, sizeof(NeuralNetwork));
+    if (!nn) {
         fprintf(stderr, "Memory allocation failed\n");
-        free(nn->w1);
-        free(nn->w2);
-        free(nn->b1);
-        free(nn->b2);
-        free(nn);
+        free_vocabulary();
         fclose(file);
         return NULL;
     }
 
-    // Read weights and biases
-    fread(nn->w1, sizeof(float), nn->input_size * nn->hidden_size, file);
-    fread(nn->w2, sizeof(float), nn->hidden_size * nn->output_size, file);
-    fread(nn->b1, sizeof(float), nn->hidden_size, file);
-    fread(nn->b2, sizeof(float), nn->output_size, file);
-
+    int result = legacy ? load_legacy_nn(nn, file) : load_layered_nn(nn, file);
     fclose(file);
+    if (result != 0) {
+        free_vocabulary();
+        free(nn);
+        return NULL;
+    }
     return nn;
 }
 